@@ -2,11 +2,16 @@
 #define CPPTREE_NODE_H
 
 #include "cppTreeMacros.h"
+#include "cppTreeNodeTable.h"
+#include "cppTreeSnapshot.h"
 
 #include <deque>
+#include <map>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace cpptree {
@@ -14,11 +19,14 @@ namespace cpptree {
 class BaseNode {
 	friend class Node;
 	friend class RestrictiveNode;
+	friend class Reclaimer;
 
 protected:
 	enum class Change {
 		ADD,
-		REMOVE
+		REMOVE,
+		//! @brief The node got a new parent in place of an old one, only passed to onParentChange
+		MOVE
 	};
 
 protected:
@@ -29,6 +37,25 @@ protected:
 	std::deque<BaseNode *> m_previousParents;
 	BaseNode *m_parent;
 
+	//! @brief Topological level of the node, always greater than the level of any of its parents
+	std::int64_t m_level;
+
+	//! @brief Cached snapshot of the subtree, reset whenever the subtree changes
+	mutable std::shared_ptr<const NodeSnapshot> m_snapshot;
+
+	//! @brief Children sorted by name, only present if enabled with setChildIndex
+	std::unique_ptr<std::map<std::string_view, std::shared_ptr<BaseNode>>> m_childIndex;
+
+	//! @brief Table the node is registered in, shared by the whole tree once enabled with enableNodeIds
+	std::shared_ptr<NodeTable> m_table;
+	NodeId m_id;
+
+	//! @brief Number of nodes below the node, counted once for every path leading to them
+	std::size_t m_descendantCount;
+
+	//! @brief Number of layers below the node
+	std::size_t m_maxDepth;
+
 protected:
 	//! @brief Called when a parent is about to be assigned
 	inline virtual void onParentChange(Change type, const BaseNode *newParent) {}
@@ -45,8 +72,29 @@ protected:
 	//! @brief Called to check whether a node can get the given parent
 	virtual bool isValidParent(const BaseNode *parent) const;
 
+	/**
+	 * @brief Called on the parent and every ancestor of a changed child, from the bottom up, after the built-in aggregates were updated
+	 *
+	 * Override to maintain custom aggregates of the subtree by combining the aggregates of the children.
+	 * @param child The child on the path to the change, or the added or removed node itself
+	 */
+	inline virtual void onAggregateUpdate(const BaseNode *child) {}
+
+	/**
+	 * @brief Called when the snapshot of the node is rebuilt, returns the data of the node to attach to it
+	 *
+	 * Override to make the data of the subclass available in snapshots. Subclasses must call invalidateSnapshot
+	 * whenever that data changes.
+	 */
+	inline virtual std::shared_ptr<const SnapshotPayload> createSnapshotPayload() const { return nullptr; }
+
 protected:
-	//! @brief Adds a child to the list of children, calls the appropriate callbacks
+	/**
+	 * @brief Adds a child to the list of children, calls the appropriate callbacks
+	 *
+	 * Rejects children which are the node itself or one of its ancestors. Adding a leaf is O(1), grafting a built
+	 * subtree below a deep node costs O(ancestors + subtree) for the cycle check and the level relabeling.
+	 */
 	bool addChild(std::shared_ptr<BaseNode> newChild);
 
 	//! @brief Removes a child from the list of children, calls the appropriate callbacks
@@ -55,17 +103,60 @@ protected:
 	//! @brief Removes a child from the list of children, calls the appropriate callbacks
 	bool removeChild(const std::shared_ptr<BaseNode> &node);
 
+	//! @brief Moves a child to the list of children of `newParent` in one step, calls the appropriate callbacks
+	bool moveChild(const std::shared_ptr<BaseNode> &node, BaseNode *newParent);
+
 	//! @brief Call the onSignal handler of a child with the given name
 	bool signalChild(const std::string &name, const std::string &signal);
 
+	//! @brief Drops the cached snapshot of the node and of all its ancestors
+	void invalidateSnapshot();
+
 private:
 	void propagateSubChildChange(Change type, const std::shared_ptr<BaseNode> &child);
 
+	//! @brief Raises the level of the node to at least `level`, and the levels of its descendants accordingly
+	void raiseLevel(std::int64_t level);
+
+	//! @brief Lowers the level of the node to at most `level`, and the levels of its ancestors accordingly
+	void lowerLevel(std::int64_t level);
+
+	/**
+	 * @brief Adjusts levels so the node is ordered below `parent`
+	 *
+	 * O(1) for leaves and for parents without parents of their own, otherwise O(subtree) for the relabeled subtree.
+	 */
+	void orderBelow(BaseNode *parent);
+
+	//! @brief Returns every node the node is a descendant of, each once, in the order propagateSubChildChange first reaches them
+	std::vector<BaseNode *> getAncestors() const;
+
+	/**
+	 * @brief Updates the aggregates of the node and its ancestors after `child` changed
+	 *
+	 * @param countDelta Change in the number of descendants
+	 * @param oldDepth Number of layers contributed by `child` before the change, 0 if it was not a child
+	 * @param newDepth Number of layers contributed by `child` after the change, 0 if it is no longer a child
+	 */
+	void updateAggregates(const BaseNode *child, std::int64_t countDelta, std::size_t oldDepth, std::size_t newDepth);
+
+	/**
+	 * @brief Detaches the last `maxChildren` children, moving the ones no longer owned by anything else into `orphans`
+	 * @returns The number of children detached
+	 */
+	std::size_t releaseChildren(std::vector<std::shared_ptr<BaseNode>> &orphans, std::size_t maxChildren = (~0));
+
+	//! @brief Registers the node and its subtree in `table`
+	void joinNodeTable(const std::shared_ptr<NodeTable> &table);
+
+	//! @brief Unregisters the node and its subtree from its table, unless they are still reachable from the tree
+	void leaveNodeTable();
+
 public:
 	CPPTREE_IMPL_CONSTRUCT_AND_CREATE(
 	    BaseNode,
-	    (const std::string &name),
-	    (name));
+	    (std::string name),
+	    (std::move(name)));
 
 	BaseNode(const BaseNode &other) = delete;
 	virtual ~BaseNode();
@@ -153,10 +244,103 @@ public:
 		return dynamic_cast<const T *const>(this);
 	}
 
-	//! @brief Counts all the nodes `depth` layers deep
+	/**
+	 * @brief Gives the node and its subtree generational ids in a new NodeTable, returns the table
+	 *
+	 * Nodes added to the tree later join the table, and leave it when they lose their last path to this node.
+	 * This node stays in the table even when it is added to and removed from other parents.
+	 * If the node already belongs to a table, that table is returned instead.
+	 *
+	 * A node belongs to at most one table. A node shared with another tree which has its own table keeps the
+	 * id of the table it joined first, and only joins the other table once it loses its last path to the first one.
+	 */
+	std::shared_ptr<NodeTable> enableNodeIds();
+
+	inline const std::shared_ptr<NodeTable> &getNodeTable() const { return m_table; }
+
+	//! @brief Returns the id of the node in its table, or an invalid id if it has none
+	inline NodeId getId() const { return m_id; }
+
+	//! @brief Returns the node in the same table with the given id in O(1), or nullptr
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    getNodeById(NodeId id),
+	    BaseNode *,
+	    const BaseNode *);
+
+	//! @brief Returns the id of the node at the path provided, or an invalid id
+	NodeId getNodeIdByPath(const std::string &path) const;
+
+	//! @brief Returns the ids of all the nodes in the tree with the given name, `depth` layers deep
+	std::vector<NodeId> getNodeIdsByName(const std::string &name, unsigned int depth = (~0)) const;
+
+	//! @brief Returns the ids of all the nodes in the tree with the given name hash, `depth` layers deep
+	std::vector<NodeId> getNodeIdsByNameHash(std::size_t nameHash, unsigned int depth = (~0)) const;
+
+	//! @brief Returns the ids of all the nodes in the tree with the given type, `depth` layers deep
+	std::vector<NodeId> getNodeIdsByTypeHash(std::size_t typeHash, unsigned int depth = (~0)) const;
+
+	//! @brief Counts all the nodes `depth` layers deep - O(1) without a depth limit
 	std::size_t countNodes(unsigned int depth = (~0)) const;
 	std::size_t countParents() const;
 
+	//! @brief Returns the number of layers below the node, 0 for leaves
+	inline std::size_t getMaxDepth() const { return m_maxDepth; }
+
+	/**
+	 * @brief Returns whether the node is a parent of `node`, directly or through any number of nodes
+	 *
+	 * O(1) for leaves and for nodes whose level is not above the level of `node`. Otherwise the ancestors of `node`
+	 * with a level between the two nodes are visited, which is O(ancestors) - e.g. when a built subtree is grafted
+	 * below a deep node. Chains of nodes with a single parent are walked without allocating.
+	 */
+	bool isAncestorOf(const BaseNode *node) const;
+
+	//! @brief Returns whether `node` is a parent of the node, directly or through any number of nodes
+	bool isDescendantOf(const BaseNode *node) const;
+
+	/**
+	 * @brief Returns the deepest node which is an ancestor of both nodes (or one of the nodes themselves), or nullptr
+	 *
+	 * O(ancestors of both nodes). Walked without allocating until a node with several parents is reached.
+	 */
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    lowestCommonAncestor(const BaseNode *other),
+	    BaseNode *,
+	    const BaseNode *);
+
+	/**
+	 * @brief Enables or disables the sorted child index of the node
+	 *
+	 * With the index prefix, range and ordered queries on the children take O(log n + k) instead of O(n log n),
+	 * at the cost of O(log n) extra work when adding or removing children.
+	 */
+	void setChildIndex(bool enabled);
+	inline bool hasChildIndex() const { return m_childIndex != nullptr; }
+
+	//! @brief Returns the children sorted by name
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    getChildrenOrdered(),
+	    std::vector<std::shared_ptr<BaseNode>>,
+	    std::vector<std::shared_ptr<const BaseNode>>);
+
+	//! @brief Returns at most `limit` children, sorted by name, whose name starts with `prefix`
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    getChildrenByPrefix(std::string_view prefix, std::size_t limit = (~0)),
+	    std::vector<std::shared_ptr<BaseNode>>,
+	    std::vector<std::shared_ptr<const BaseNode>>);
+
+	//! @brief Returns at most `limit` children, sorted by name, with names in [`first`, `last`) - an empty `last` means no upper bound
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    getChildrenInRange(std::string_view first, std::string_view last, std::size_t limit = (~0)),
+	    std::vector<std::shared_ptr<BaseNode>>,
+	    std::vector<std::shared_ptr<const BaseNode>>);
+
+	//! @brief Returns all the nodes in the tree whose name starts with `prefix`, `depth` layers deep
+	CPPTREE_IMPL_DECL_FOR_MUT_CONST(
+	    getNodesByPrefix(std::string_view prefix, unsigned int depth = (~0)),
+	    std::vector<std::shared_ptr<BaseNode>>,
+	    std::vector<std::shared_ptr<const BaseNode>>);
+
 	std::string getPath() const;
 	std::vector<std::string> getAllPaths() const;
 
@@ -175,6 +359,26 @@ public:
 	 */
 	std::string getTree(bool includeTypes = false, unsigned int initialIndent = 0, unsigned int levelIndent = 2, unsigned int depth = (~0)) const;
 
+	/**
+	 * @brief Returns an immutable snapshot of the node and its subtree
+	 *
+	 * Calling this on an unchanged subtree returns the cached snapshot in O(1). After adding or removing nodes
+	 * only the nodes on the path from the change to this node are copied, the rest is shared with older snapshots,
+	 * which stay valid. Must be called from the thread modifying the tree; the returned snapshot can be read anywhere.
+	 * Data of subclasses is only included through createSnapshotPayload.
+	 *
+	 * Every node of the subtree keeps its snapshot cached until it changes, which roughly doubles the memory
+	 * used by the subtree - including subtrees removed later. Use releaseSnapshots to drop the caches.
+	 */
+	std::shared_ptr<const NodeSnapshot> snapshot() const;
+
+	/**
+	 * @brief Drops the cached snapshots of the node, its subtree and its ancestors
+	 *
+	 * Snapshots returned earlier stay valid. The next call to snapshot rebuilds the subtree. O(n) in the size of the subtree.
+	 */
+	void releaseSnapshots();
+
 	constexpr static const std::size_t nodeType = 0;
 	constexpr static const char *nodeTypeName = "BaseNode";
 };
@@ -184,8 +388,8 @@ class Node : public BaseNode {
 public:
 	CPPTREE_IMPL_CONSTRUCT_AND_CREATE(
 	    Node,
-	    (const std::string &name),
-	    (name));
+	    (std::string name),
+	    (std::move(name)));
 
 	//! @brief Adds a node to the current node
 	virtual bool addLocalNode(std::shared_ptr<BaseNode> node);
@@ -197,14 +401,47 @@ public:
 	//! @brief Adds a node to the current node
 	bool addLocalNode(std::shared_ptr<T> node)
 	{
-		return addLocalNode(std::dynamic_pointer_cast<BaseNode>(node));
+		return addLocalNode(std::shared_ptr<BaseNode>(std::move(node)));
 	}
 
 	template <typename T, typename = std::enable_if_t<std::is_base_of_v<BaseNode, T>>>
 	//! @brief Adds a node at a specified path - path "" is the same as calling addLocalNode
 	bool addNode(const std::string &path, std::shared_ptr<T> node)
 	{
-		return addNode(path, std::dynamic_pointer_cast<BaseNode>(node));
+		return addNode(path, std::shared_ptr<BaseNode>(std::move(node)));
+	}
+
+	template <typename T, typename... Args>
+	/**
+	 * @brief Constructs a T in place from `args` and adds it to the current node
+	 * @returns The new node, or nullptr if it could not be added
+	 */
+	std::enable_if_t<std::is_base_of_v<BaseNode, T>, std::shared_ptr<T>> emplaceLocalNode(Args &&...args)
+	{
+		auto node = CPPTREE_ALLOCATOR<T>(std::forward<Args>(args)...);
+
+		if (!addLocalNode(std::shared_ptr<BaseNode>(node)))
+			return nullptr;
+
+		return node;
+	}
+
+	template <typename T, typename... Args>
+	/**
+	 * @brief Constructs a T in place from `args` and adds it at a specified path - path "" is the same as calling emplaceLocalNode
+	 * @returns The new node, or nullptr if it could not be added
+	 */
+	std::enable_if_t<std::is_base_of_v<BaseNode, T>, std::shared_ptr<T>> emplaceNode(const std::string &path, Args &&...args)
+	{
+		if (path.empty())
+			return emplaceLocalNode<T>(std::forward<Args>(args)...);
+
+		const auto parent = getNodeByPath<Node>(path);
+
+		if (!parent)
+			return nullptr;
+
+		return parent->emplaceLocalNode<T>(std::forward<Args>(args)...);
 	}
 
 	//! @brief Tries to remove a local node with the name provided
@@ -213,6 +450,29 @@ public:
 	//! @brief Tries to remove a local node, fails if the node is not a child of the current node
 	virtual bool removeLocalNode(const std::shared_ptr<BaseNode> &node);
 
+	/**
+	 * @brief Moves a child of the current node to `newParent` in one step, fails if the node is not a child of the current node
+	 *
+	 * Both parents must be Nodes, and both have to accept the move through isValidMove.
+	 * The node gets a single onParentChange(MOVE) call, and only the ancestors which gain or lose the node
+	 * are notified through onSubChildChange.
+	 */
+	virtual bool moveNode(const std::shared_ptr<BaseNode> &node, const std::shared_ptr<BaseNode> &newParent);
+
+	//! @brief Moves the node at `srcPath` below the node at `dstPath` - path "" refers to the current node
+	virtual bool moveNode(const std::string &srcPath, const std::string &dstPath);
+
+protected:
+	/**
+	 * @brief Checks whether `node` may be moved out of (REMOVE) or into (ADD) the current node by moveNode
+	 * @returns true by default
+	 */
+	virtual bool isValidMove(Change type, const BaseNode *node) const;
+
+private:
+	bool moveBetween(Node *from, const std::shared_ptr<BaseNode> &node, Node *to);
+
+public:
 	CPPTREE_IMPL_GET_TYPE(nodeType);
 
 	constexpr static const std::size_t nodeType = 1;
@@ -230,13 +490,17 @@ protected:
 public:
 	CPPTREE_IMPL_CONSTRUCT_AND_CREATE(
 	    RestrictiveNode,
-	    (const std::string &name, std::vector<std::string> addtype = {}, std::vector<std::string> remtype = {}),
-	    (name, addtype, remtype));
+	    (std::string name, std::vector<std::string> addtype = {}, std::vector<std::string> remtype = {}),
+	    (std::move(name), std::move(addtype), std::move(remtype)));
 
 	virtual bool addLocalNode(std::shared_ptr<BaseNode> node) override;
 
 	virtual bool removeLocalNode(const std::string &name) override;
 	virtual bool removeLocalNode(const std::shared_ptr<BaseNode> &node) override;
+
+protected:
+	//! @brief Applies allow_remtype to nodes moved out of, and allow_addtype to nodes moved into the current node
+	virtual bool isValidMove(Change type, const BaseNode *node) const override;
 };
 
 using BaseNodePtr = std::shared_ptr<BaseNode>;
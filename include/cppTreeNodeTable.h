@@ -0,0 +1,78 @@
+#ifndef CPPTREE_NODE_TABLE_H
+#define CPPTREE_NODE_TABLE_H
+
+#include "cppTreeMacros.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace cpptree {
+class BaseNode;
+
+/** @brief Weak, generational identifier of a node within a cpptree::NodeTable */
+struct NodeId {
+	std::uint32_t index = 0;
+	//! @brief Generation of the slot when the id was issued, 0 for invalid ids
+	std::uint32_t generation = 0;
+
+	inline constexpr bool isValid() const { return generation != 0; }
+
+	inline constexpr bool operator==(const NodeId &other) const { return index == other.index && generation == other.generation; }
+	inline constexpr bool operator!=(const NodeId &other) const { return !(*this == other); }
+};
+
+/**
+ * @brief Slot table mapping NodeIds to the nodes of a tree
+ *
+ * Slots are reused after a node leaves the table, with an increased generation, so stale ids never resolve to
+ * a different node. The table is not thread safe, it is read and modified together with its tree.
+ * @see cpptree::BaseNode::enableNodeIds
+ */
+class NodeTable {
+	friend class BaseNode;
+
+private:
+	struct Slot {
+		BaseNode *node;
+		std::uint32_t generation;
+	};
+
+	std::vector<Slot> m_slots;
+	std::vector<std::uint32_t> m_freeSlots;
+	std::size_t m_size;
+
+	//! @brief Node which created the table, nodes stay in the table while they have a path to it
+	BaseNode *m_root;
+
+private:
+	NodeId insert(BaseNode *node);
+	void erase(NodeId id);
+
+public:
+	NodeTable();
+	NodeTable(const NodeTable &other) = delete;
+
+	//! @brief Returns the node with the given id, or nullptr if it was removed from the tree
+	BaseNode *lookup(NodeId id) const;
+
+	//! @brief Returns the number of nodes in the table
+	inline std::size_t size() const { return m_size; }
+
+	//! @brief Returns the node which created the table, or nullptr if it left the table
+	inline BaseNode *getRoot() const { return m_root; }
+};
+
+} // namespace cpptree
+
+namespace std {
+template <>
+struct hash<cpptree::NodeId> {
+	inline std::size_t operator()(const cpptree::NodeId &id) const
+	{
+		return std::hash<std::uint64_t>{}((static_cast<std::uint64_t>(id.generation) << 32) | id.index);
+	}
+};
+} // namespace std
+
+#endif // !defined(CPPTREE_NODE_TABLE_H)
@@ -0,0 +1,57 @@
+#ifndef CPPTREE_RECLAIMER_H
+#define CPPTREE_RECLAIMER_H
+
+#include "cppTreeNode.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cpptree {
+/**
+ * @brief Releases detached subtrees away from latency-sensitive code
+ *
+ * Retired nodes are released either in bounded batches through reclaim, or by a background thread started with start.
+ * A batch is measured in steps: detaching one child is one step, releasing a node without children is one step.
+ * Releasing a node updates the parent pointers of its children and calls their onParentChange, so retired subtrees
+ * must not share nodes with trees still used by other threads while the background thread is running.
+ */
+class Reclaimer {
+private:
+	std::vector<std::shared_ptr<BaseNode>> m_pending;
+	mutable std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+	bool m_stopping;
+
+public:
+	Reclaimer();
+	Reclaimer(const Reclaimer &other) = delete;
+
+	//! @brief Stops the background thread and releases all remaining nodes
+	~Reclaimer();
+
+	//! @brief Hands a node over to be released together with its subtree, nodes owned elsewhere are left alone
+	void retire(std::shared_ptr<BaseNode> node);
+
+	/**
+	 * @brief Releases retired nodes on the calling thread in at most `maxSteps` steps, returns the number of nodes released
+	 *
+	 * Nodes with more children than steps left are partially released and finished by later calls.
+	 */
+	std::size_t reclaim(std::size_t maxSteps = (~0));
+
+	//! @brief Starts releasing retired nodes on a background thread, in batches of `batchSize` steps
+	void start(std::size_t batchSize = 1024);
+
+	//! @brief Stops the background thread, nodes not yet released stay pending
+	void stop();
+
+	std::size_t countPending() const;
+};
+
+} // namespace cpptree
+
+#endif // !defined(CPPTREE_RECLAIMER_H)
@@ -0,0 +1,72 @@
+#ifndef CPPTREE_SNAPSHOT_H
+#define CPPTREE_SNAPSHOT_H
+
+#include "cppTreeMacros.h"
+
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace cpptree {
+/**
+ * @brief Base class for immutable data attached to snapshots by subclasses of cpptree::BaseNode
+ * @see cpptree::BaseNode::createSnapshotPayload
+ */
+class SnapshotPayload {
+public:
+	virtual ~SnapshotPayload() = default;
+};
+
+/**
+ * @brief Immutable copy of a node and its subtree
+ *
+ * Snapshots are never modified after creation, so they can be read from any thread without locking.
+ * Subtrees which did not change between two snapshots are shared between them.
+ * @see cpptree::BaseNode::snapshot
+ */
+class NodeSnapshot {
+private:
+	std::vector<std::shared_ptr<const NodeSnapshot>> m_children;
+	std::string m_name;
+	std::size_t m_nameHash;
+	std::string m_type;
+	std::size_t m_typeHash;
+	std::shared_ptr<const SnapshotPayload> m_payload;
+	std::size_t m_descendantCount;
+
+public:
+	NodeSnapshot(std::string name, std::size_t nameHash, std::string type, std::size_t typeHash,
+	             std::vector<std::shared_ptr<const NodeSnapshot>> children, std::shared_ptr<const SnapshotPayload> payload = nullptr);
+
+	NodeSnapshot(const NodeSnapshot &other) = delete;
+	~NodeSnapshot();
+
+	//! @brief Tries to return a node by the path provided, otherwise returns nullptr
+	std::shared_ptr<const NodeSnapshot> getNodeByPath(const std::string &path) const;
+
+	//! @brief Returns a child with a given name hash, or nullptr
+	std::shared_ptr<const NodeSnapshot> getNodeByNameHash(std::size_t nameHash) const;
+
+	//! @brief Counts all the nodes `depth` layers deep - O(1) without a depth limit
+	std::size_t countNodes(unsigned int depth = (~0)) const;
+
+	inline const std::string &getName() const { return m_name; }
+	inline std::size_t getNameHash() const { return m_nameHash; }
+	inline const std::string &getType() const { return m_type; }
+	inline std::size_t getTypeHash() const { return m_typeHash; }
+	inline const std::vector<std::shared_ptr<const NodeSnapshot>> &getChildren() const { return m_children; }
+
+	template <typename T, typename = std::enable_if_t<std::is_base_of_v<SnapshotPayload, T>>>
+	//! @brief Returns the payload attached by the node as a T, or nullptr
+	std::shared_ptr<const T> getPayload() const
+	{
+		return std::dynamic_pointer_cast<const T>(m_payload);
+	}
+};
+
+using NodeSnapshotPtr = std::shared_ptr<const NodeSnapshot>;
+
+} // namespace cpptree
+
+#endif // !defined(CPPTREE_SNAPSHOT_H)
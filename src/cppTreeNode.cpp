@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <functional>
 #include <queue>
+#include <unordered_set>
 
 // clang-format off
 #define CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(sig1, sig2, impl) \
@@ -24,8 +25,13 @@ namespace cpptree {
 	if (!newChild->isValidParent(this))
 		return false;
 
-	if (std::find_if(m_children.begin(), m_children.end(), [newChild](const auto &child) {
-		    return child->m_nameHash == newChild->m_nameHash;
+	// adding an ancestor as a child would create a cycle
+	if (newChild.get() == this || newChild->isAncestorOf(this))
+		return false;
+
+	const auto nameHash = newChild->m_nameHash;
+	if (std::find_if(m_children.begin(), m_children.end(), [nameHash](const auto &child) {
+		    return child->m_nameHash == nameHash;
 	    }) != m_children.end()) {
 		return false;
 	}
@@ -38,10 +44,21 @@ namespace cpptree {
 		newChild->m_previousParents.push_back(newChild->m_parent);
 
 	newChild->m_parent = this;
+	newChild->orderBelow(this);
+
+	if (m_childIndex)
+		m_childIndex->emplace(newChild->m_name, newChild);
 
-	m_children.push_back(newChild);
+	m_children.push_back(std::move(newChild));
+	invalidateSnapshot();
 
-	propagateSubChildChange(Change::ADD, newChild);
+	if (m_table && !m_children.back()->m_table)
+		m_children.back()->joinNodeTable(m_table);
+
+	const auto &addedChild = m_children.back();
+	updateAggregates(addedChild.get(), 1 + addedChild->m_descendantCount, 0, addedChild->m_maxDepth + 1);
+
+	propagateSubChildChange(Change::ADD, addedChild);
 
 	return true;
 }
@@ -75,7 +92,16 @@ namespace cpptree {
 
 		propagateSubChildChange(Change::REMOVE, *localNode);
 
+		if (m_childIndex)
+			m_childIndex->erase((*localNode)->m_name);
+
+		(*localNode)->leaveNodeTable();
+
+		const auto removedChild = std::move(*localNode);
 		m_children.erase(localNode);
+		invalidateSnapshot();
+
+		updateAggregates(removedChild.get(), -static_cast<std::int64_t>(1 + removedChild->m_descendantCount), removedChild->m_maxDepth + 1, 0);
 		return true;
 	}
 
@@ -104,7 +130,114 @@ namespace cpptree {
 
 	propagateSubChildChange(Change::REMOVE, node);
 
-	m_children.erase(std::find(m_children.begin(), m_children.end(), node));
+	if (m_childIndex)
+		m_childIndex->erase(node->m_name);
+
+	node->leaveNodeTable();
+
+	// `node` may refer to the element itself, so ownership is taken before erasing it
+	const auto localNode = std::find(m_children.begin(), m_children.end(), node);
+	const auto removedChild = std::move(*localNode);
+	m_children.erase(localNode);
+	invalidateSnapshot();
+
+	updateAggregates(removedChild.get(), -static_cast<std::int64_t>(1 + removedChild->m_descendantCount), removedChild->m_maxDepth + 1, 0);
+	return true;
+}
+
+/* protected */ bool BaseNode::moveChild(const std::shared_ptr<BaseNode> &node, BaseNode *newParent)
+{
+	if (!node || !newParent || newParent == this)
+		return false;
+
+	const auto localNode = std::find(m_children.begin(), m_children.end(), node);
+
+	if (localNode == m_children.end() || !node->isValidParent(newParent))
+		return false;
+
+	if (node.get() == newParent || node->isAncestorOf(newParent))
+		return false;
+
+	const auto nameHash = node->m_nameHash;
+	if (std::find_if(newParent->m_children.begin(), newParent->m_children.end(), [nameHash](const auto &child) {
+		    return child->m_nameHash == nameHash;
+	    }) != newParent->m_children.end()) {
+		return false;
+	}
+
+	// ancestors which still contain the node through another parent, or through both positions, see no change
+	std::unordered_set<BaseNode *> unchanged;
+	const auto keepAncestors = [&unchanged](BaseNode *parent) {
+		const auto ancestors = parent->getAncestors();
+
+		unchanged.insert(parent);
+		unchanged.insert(ancestors.begin(), ancestors.end());
+	};
+
+	for (const auto parent : node->m_previousParents)
+		if (parent != this)
+			keepAncestors(parent);
+
+	if (node->m_parent != this && node->m_parent)
+		keepAncestors(node->m_parent);
+
+	// both lists keep the bottom-up order of propagateSubChildChange, so the callbacks fire in a fixed order
+	auto losing = getAncestors();
+	auto gaining = newParent->getAncestors();
+	const std::unordered_set<BaseNode *> losingSet(losing.begin(), losing.end());
+	const std::unordered_set<BaseNode *> gainingSet(gaining.begin(), gaining.end());
+
+	losing.erase(std::remove_if(losing.begin(), losing.end(), [&](BaseNode *ancestor) {
+		             return unchanged.count(ancestor) != 0 || gainingSet.count(ancestor) != 0;
+	             }),
+	             losing.end());
+
+	gaining.erase(std::remove_if(gaining.begin(), gaining.end(), [&](BaseNode *ancestor) {
+		              return unchanged.count(ancestor) != 0 || losingSet.count(ancestor) != 0;
+	              }),
+	              gaining.end());
+
+	onChildChange(Change::REMOVE, node);
+	newParent->onChildChange(Change::ADD, node);
+	node->onParentChange(Change::MOVE, newParent);
+
+	auto child = std::move(*localNode);
+	m_children.erase(localNode);
+
+	if (child->m_parent == this)
+		child->m_parent = newParent;
+	else
+		*std::find(child->m_previousParents.begin(), child->m_previousParents.end(), this) = newParent;
+
+	child->orderBelow(newParent);
+
+	if (m_childIndex)
+		m_childIndex->erase(child->m_name);
+
+	if (newParent->m_childIndex)
+		newParent->m_childIndex->emplace(child->m_name, child);
+
+	newParent->m_children.push_back(std::move(child));
+	const auto &movedChild = newParent->m_children.back();
+
+	invalidateSnapshot();
+	newParent->invalidateSnapshot();
+
+	movedChild->leaveNodeTable();
+
+	if (newParent->m_table && !movedChild->m_table)
+		movedChild->joinNodeTable(newParent->m_table);
+
+	const auto movedCount = static_cast<std::int64_t>(1 + movedChild->m_descendantCount);
+	updateAggregates(movedChild.get(), -movedCount, movedChild->m_maxDepth + 1, 0);
+	newParent->updateAggregates(movedChild.get(), movedCount, 0, movedChild->m_maxDepth + 1);
+
+	for (const auto ancestor : losing)
+		ancestor->onSubChildChange(Change::REMOVE, movedChild);
+
+	for (const auto ancestor : gaining)
+		ancestor->onSubChildChange(Change::ADD, movedChild);
+
 	return true;
 }
 
@@ -136,22 +269,165 @@ namespace cpptree {
 	}
 }
 
-BaseNode::BaseNode(const std::string &name)
-    : m_children(), m_name(name), m_nameHash(), m_parent(nullptr), m_previousParents()
+/* protected */ void BaseNode::invalidateSnapshot()
 {
-	auto slashIterator = m_name.find('/');
+	// a node without a snapshot has no ancestor with a snapshot either, so the walk can stop there
+	std::vector<BaseNode *> pending = {this};
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
 
-	while (slashIterator != std::string::npos) {
-		m_name = m_name.replace(m_name.begin() + slashIterator, m_name.begin() + slashIterator + 1, "_");
-		slashIterator = m_name.find('/', slashIterator + 1);
+		if (!node->m_snapshot)
+			continue;
+
+		node->m_snapshot.reset();
+
+		if (node->m_parent)
+			pending.push_back(node->m_parent);
+
+		pending.insert(pending.end(), node->m_previousParents.begin(), node->m_previousParents.end());
 	}
+}
 
-	m_nameHash = std::hash<std::string>{}(name);
+/* private */ void BaseNode::raiseLevel(std::int64_t level)
+{
+	std::vector<std::pair<BaseNode *, std::int64_t>> pending = {{this, level}};
+
+	while (!pending.empty()) {
+		const auto [node, nodeLevel] = pending.back();
+		pending.pop_back();
+
+		if (node->m_level >= nodeLevel)
+			continue;
+
+		node->m_level = nodeLevel;
+
+		for (const auto &child : node->m_children)
+			pending.emplace_back(child.get(), nodeLevel + 1);
+	}
 }
 
-/* virtual */ BaseNode::~BaseNode()
+/* private */ void BaseNode::lowerLevel(std::int64_t level)
 {
-	for (auto &child : m_children) {
+	std::vector<std::pair<BaseNode *, std::int64_t>> pending = {{this, level}};
+
+	while (!pending.empty()) {
+		const auto [node, nodeLevel] = pending.back();
+		pending.pop_back();
+
+		if (node->m_level <= nodeLevel)
+			continue;
+
+		node->m_level = nodeLevel;
+
+		if (node->m_parent)
+			pending.emplace_back(node->m_parent, nodeLevel - 1);
+
+		for (const auto parent : node->m_previousParents)
+			pending.emplace_back(parent, nodeLevel - 1);
+	}
+}
+
+/* private */ void BaseNode::orderBelow(BaseNode *parent)
+{
+	if (m_level > parent->m_level)
+		return;
+
+	// fresh leaves are pushed below the parent and fresh roots are pulled above the child, both in O(1)
+	if (!m_children.empty() && parent->countParents() == 0)
+		parent->lowerLevel(m_level - 1);
+	else
+		raiseLevel(parent->m_level + 1);
+}
+
+/* private */ std::vector<BaseNode *> BaseNode::getAncestors() const
+{
+	// visits the parents depth first, current parent before previous ones, like propagateSubChildChange
+	std::vector<BaseNode *> result;
+	std::unordered_set<const BaseNode *> visited;
+	std::vector<BaseNode *> pending(m_previousParents.rbegin(), m_previousParents.rend());
+
+	if (m_parent)
+		pending.push_back(m_parent);
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
+
+		if (!visited.insert(node).second)
+			continue;
+
+		result.push_back(node);
+		pending.insert(pending.end(), node->m_previousParents.rbegin(), node->m_previousParents.rend());
+
+		if (node->m_parent)
+			pending.push_back(node->m_parent);
+	}
+
+	return result;
+}
+
+/* private */ void BaseNode::updateAggregates(const BaseNode *child, std::int64_t countDelta, std::size_t oldDepth, std::size_t newDepth)
+{
+	struct Step {
+		BaseNode *node;
+		const BaseNode *child;
+		std::size_t oldDepth;
+		std::size_t newDepth;
+	};
+
+	// every path is walked separately, so descendants reachable through several paths are counted for each of them
+	std::vector<Step> pending = {{this, child, oldDepth, newDepth}};
+
+	while (!pending.empty()) {
+		const auto step = pending.back();
+		pending.pop_back();
+
+		BaseNode *node = step.node;
+		const auto previousMaxDepth = node->m_maxDepth;
+
+		node->m_descendantCount = static_cast<std::size_t>(static_cast<std::int64_t>(node->m_descendantCount) + countDelta);
+
+		if (step.newDepth > node->m_maxDepth) {
+			node->m_maxDepth = step.newDepth;
+		}
+		else if (step.oldDepth == node->m_maxDepth && step.newDepth < step.oldDepth) {
+			// the deepest branch got shallower, so another branch may be the deepest now
+			node->m_maxDepth = 0;
+
+			for (const auto &other : node->m_children)
+				node->m_maxDepth = std::max(node->m_maxDepth, other->m_maxDepth + 1);
+		}
+
+		node->onAggregateUpdate(step.child);
+
+		if (node->m_parent)
+			pending.push_back({node->m_parent, node, previousMaxDepth + 1, node->m_maxDepth + 1});
+
+		for (const auto parent : node->m_previousParents)
+			pending.push_back({parent, node, previousMaxDepth + 1, node->m_maxDepth + 1});
+	}
+}
+
+BaseNode::BaseNode(std::string name)
+    : m_children(), m_name(std::move(name)), m_nameHash(), m_previousParents(), m_parent(nullptr), m_level(0), m_snapshot(), m_childIndex(), m_table(), m_id(), m_descendantCount(0), m_maxDepth(0)
+{
+	std::replace(m_name.begin(), m_name.end(), '/', '_');
+
+	m_nameHash = std::hash<std::string>{}(m_name);
+}
+
+/* private */ std::size_t BaseNode::releaseChildren(std::vector<std::shared_ptr<BaseNode>> &orphans, std::size_t maxChildren)
+{
+	// the index holds references too, which would keep the children from being recognised as orphans
+	m_childIndex.reset();
+
+	const auto count = std::min(maxChildren, m_children.size());
+	const auto first = m_children.end() - static_cast<std::ptrdiff_t>(count);
+
+	for (auto it = first; it != m_children.end(); ++it) {
+		auto &child = *it;
 		auto &prevParents = child->m_previousParents;
 		if (child->m_parent == this) {
 			child->m_parent = (prevParents.size() > 0) ? prevParents.back() : nullptr;
@@ -167,6 +443,126 @@ BaseNode::BaseNode(const std::string &name)
 		}
 
 		child->onParentChange(Change::REMOVE, this);
+
+		if (child.use_count() == 1)
+			orphans.push_back(std::move(child));
+		else
+			child->leaveNodeTable();
+	}
+
+	m_children.erase(first, m_children.end());
+	return count;
+}
+
+/* private */ void BaseNode::joinNodeTable(const std::shared_ptr<NodeTable> &table)
+{
+	std::vector<BaseNode *> pending = {this};
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
+
+		// a node belongs to one table at a time, nodes of another tree keep their ids until they leave it
+		if (node->m_table)
+			continue;
+
+		node->m_table = table;
+		node->m_id = table->insert(node);
+
+		for (const auto &child : node->m_children)
+			pending.push_back(child.get());
+	}
+}
+
+/* private */ void BaseNode::leaveNodeTable()
+{
+	const auto table = m_table;
+	const auto hasParentInTable = [&table](const BaseNode *node, const std::unordered_set<BaseNode *> &excluded) {
+		if (node->m_parent && node->m_parent->m_table == table && excluded.count(node->m_parent) == 0)
+			return true;
+
+		return std::any_of(node->m_previousParents.begin(), node->m_previousParents.end(), [&table, &excluded](BaseNode *parent) {
+			return parent->m_table == table && excluded.count(parent) == 0;
+		});
+	};
+
+	// the root of the table always stays, so do nodes which still have a parent in the table
+	if (!table || table->m_root == this || hasParentInTable(this, {}))
+		return;
+
+	std::unordered_set<BaseNode *> subtree = {this};
+	std::vector<BaseNode *> pending = {this};
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
+
+		for (const auto &child : node->m_children)
+			if (child->m_table == table && subtree.insert(child.get()).second)
+				pending.push_back(child.get());
+	}
+
+	// nodes with another parent in the tree stay in the table, together with their descendants
+	for (const auto node : subtree)
+		if (node != this && (node == table->m_root || hasParentInTable(node, subtree)))
+			pending.push_back(node);
+
+	std::unordered_set<BaseNode *> kept(pending.begin(), pending.end());
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
+
+		for (const auto &child : node->m_children)
+			if (subtree.count(child.get()) != 0 && kept.insert(child.get()).second)
+				pending.push_back(child.get());
+	}
+
+	std::vector<BaseNode *> removed;
+
+	for (const auto node : subtree) {
+		if (kept.count(node) == 0) {
+			table->erase(node->m_id);
+			node->m_table.reset();
+			node->m_id = NodeId();
+			removed.push_back(node);
+		}
+	}
+
+	// nodes shared with another tree join the table of that tree instead
+	for (const auto node : removed) {
+		if (node->m_table)
+			continue;
+
+		if (node->m_parent && node->m_parent->m_table) {
+			node->joinNodeTable(node->m_parent->m_table);
+			continue;
+		}
+
+		const auto parentInTable = std::find_if(node->m_previousParents.begin(), node->m_previousParents.end(), [](BaseNode *parent) {
+			return parent->m_table != nullptr;
+		});
+
+		if (parentInTable != node->m_previousParents.end())
+			node->joinNodeTable((*parentInTable)->m_table);
+	}
+}
+
+/* virtual */ BaseNode::~BaseNode()
+{
+	if (m_table)
+		m_table->erase(m_id);
+
+	// children only owned by this node are released here one by one instead of recursively,
+	// so the stack doesn't grow with the depth of the tree
+	std::vector<std::shared_ptr<BaseNode>> orphans;
+	releaseChildren(orphans);
+
+	while (!orphans.empty()) {
+		auto node = std::move(orphans.back());
+		orphans.pop_back();
+
+		node->releaseChildren(orphans);
 	}
 }
 
@@ -287,8 +683,79 @@ CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
 	    return nullptr;
     })
 
+std::shared_ptr<NodeTable> BaseNode::enableNodeIds()
+{
+	if (!m_table) {
+		auto table = std::make_shared<NodeTable>();
+		table->m_root = this;
+
+		joinNodeTable(table);
+	}
+
+	return m_table;
+}
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    BaseNode *BaseNode::getNodeById(NodeId id),
+    const BaseNode *BaseNode::getNodeById(NodeId id) const,
+    {
+	    return m_table ? m_table->lookup(id) : nullptr;
+    })
+
+NodeId BaseNode::getNodeIdByPath(const std::string &path) const
+{
+	const auto node = getNodeByPath(path);
+	return node ? node->m_id : NodeId();
+}
+
+std::vector<NodeId> BaseNode::getNodeIdsByName(const std::string &name, unsigned int depth) const
+{
+	return getNodeIdsByNameHash(std::hash<std::string>{}(name), depth);
+}
+
+std::vector<NodeId> BaseNode::getNodeIdsByNameHash(std::size_t nameHash, unsigned int depth) const
+{
+	if (depth == 0) {
+		return {};
+	}
+	else {
+		std::vector<NodeId> result = {};
+		for (const auto &child : m_children) {
+			if (child->m_nameHash == nameHash)
+				result.push_back(child->m_id);
+
+			auto matchesOfChild = child->getNodeIdsByNameHash(nameHash, depth - 1);
+			result.insert(result.end(), matchesOfChild.begin(), matchesOfChild.end());
+		}
+
+		return result;
+	}
+}
+
+std::vector<NodeId> BaseNode::getNodeIdsByTypeHash(std::size_t typeHash, unsigned int depth) const
+{
+	if (depth == 0) {
+		return {};
+	}
+	else {
+		std::vector<NodeId> result = {};
+		for (const auto &child : m_children) {
+			if (child->getTypeHash() == typeHash)
+				result.push_back(child->m_id);
+
+			auto matchesOfChild = child->getNodeIdsByTypeHash(typeHash, depth - 1);
+			result.insert(result.end(), matchesOfChild.begin(), matchesOfChild.end());
+		}
+
+		return result;
+	}
+}
+
 std::size_t BaseNode::countNodes(unsigned int depth) const
 {
+	if (depth == static_cast<unsigned int>(~0))
+		return m_descendantCount;
+
 	std::size_t result = m_children.size();
 
 	if (depth > 0)
@@ -303,6 +770,218 @@ std::size_t BaseNode::countParents() const
 	return m_previousParents.size() + static_cast<std::size_t>(m_parent != nullptr);
 }
 
+bool BaseNode::isAncestorOf(const BaseNode *node) const
+{
+	if (!node || node == this || m_children.empty() || m_level >= node->m_level)
+		return false;
+
+	// levels strictly decrease upwards, so parents at or below our own level can't lead to this node.
+	// Single-parent stretches are followed by pointer only, nodes with several parents are expanded once
+	std::vector<const BaseNode *> pending = {node};
+	std::unordered_set<const BaseNode *> expanded;
+
+	while (!pending.empty()) {
+		const BaseNode *current = pending.back();
+		pending.pop_back();
+
+		while (current && current->m_level > m_level) {
+			if (current->m_parent == this)
+				return true;
+
+			if (!current->m_previousParents.empty()) {
+				if (!expanded.insert(current).second)
+					break;
+
+				for (const auto parent : current->m_previousParents) {
+					if (parent == this)
+						return true;
+
+					if (parent->m_level > m_level)
+						pending.push_back(parent);
+				}
+			}
+
+			current = current->m_parent;
+		}
+	}
+
+	return false;
+}
+
+bool BaseNode::isDescendantOf(const BaseNode *node) const
+{
+	return node && node->isAncestorOf(this);
+}
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    BaseNode *BaseNode::lowestCommonAncestor(const BaseNode *other),
+    const BaseNode *BaseNode::lowestCommonAncestor(const BaseNode *other) const,
+    {
+	    using pointer_type = decltype(lowestCommonAncestor(other));
+	    if (!other)
+		    return nullptr;
+
+	    // while neither side has several parents, the deeper one steps up until both meet
+	    pointer_type self = this;
+	    const BaseNode *otherSelf = other;
+
+	    while (self && otherSelf && self != otherSelf && self->m_previousParents.empty() && otherSelf->m_previousParents.empty()) {
+		    if (self->m_level > otherSelf->m_level)
+			    self = self->m_parent;
+		    else
+			    otherSelf = otherSelf->m_parent;
+	    }
+
+	    if (!self || !otherSelf)
+		    return nullptr;
+	    else if (self == otherSelf)
+		    return self;
+
+	    std::unordered_set<const BaseNode *> ancestorsOfOther = {other};
+	    std::vector<const BaseNode *> pendingOther = {other};
+
+	    while (!pendingOther.empty()) {
+		    const BaseNode *current = pendingOther.back();
+		    pendingOther.pop_back();
+
+		    if (current->m_parent && ancestorsOfOther.insert(current->m_parent).second)
+			    pendingOther.push_back(current->m_parent);
+
+		    for (const auto parent : current->m_previousParents)
+			    if (ancestorsOfOther.insert(parent).second)
+				    pendingOther.push_back(parent);
+	    }
+
+	    pointer_type result = nullptr;
+	    std::unordered_set<const BaseNode *> visited = {this};
+	    std::vector<pointer_type> pending = {this};
+
+	    while (!pending.empty()) {
+		    pointer_type current = pending.back();
+		    pending.pop_back();
+
+		    if (ancestorsOfOther.count(current) != 0) {
+			    // ancestors of a common ancestor are common too, but never deeper
+			    if (!result || current->m_level > result->m_level)
+				    result = current;
+
+			    continue;
+		    }
+
+		    if (current->m_parent && visited.insert(current->m_parent).second)
+			    pending.push_back(current->m_parent);
+
+		    for (const auto parent : current->m_previousParents)
+			    if (visited.insert(parent).second)
+				    pending.push_back(parent);
+	    }
+
+	    return result;
+    })
+
+void BaseNode::setChildIndex(bool enabled)
+{
+	if (!enabled) {
+		m_childIndex.reset();
+	}
+	else if (!m_childIndex) {
+		m_childIndex = std::make_unique<std::map<std::string_view, std::shared_ptr<BaseNode>>>();
+
+		for (const auto &child : m_children)
+			m_childIndex->emplace(child->m_name, child);
+	}
+}
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    std::vector<std::shared_ptr<BaseNode>> BaseNode::getChildrenOrdered(),
+    std::vector<std::shared_ptr<const BaseNode>> BaseNode::getChildrenOrdered() const,
+    {
+	    return getChildrenInRange(std::string_view(), std::string_view());
+    })
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    std::vector<std::shared_ptr<BaseNode>> BaseNode::getChildrenByPrefix(std::string_view prefix, std::size_t limit),
+    std::vector<std::shared_ptr<const BaseNode>> BaseNode::getChildrenByPrefix(std::string_view prefix, std::size_t limit) const,
+    {
+	    using return_type = decltype(getChildrenByPrefix(prefix, limit));
+	    const auto hasPrefix = [prefix](std::string_view name) {
+		    return name.compare(0, prefix.size(), prefix) == 0;
+	    };
+
+	    return_type result = {};
+
+	    if (m_childIndex) {
+		    for (auto it = m_childIndex->lower_bound(prefix); it != m_childIndex->end() && result.size() < limit && hasPrefix(it->first); ++it)
+			    result.push_back(it->second);
+	    }
+	    else {
+		    for (const auto &child : m_children)
+			    if (hasPrefix(child->m_name))
+				    result.push_back(child);
+
+		    std::sort(result.begin(), result.end(), [](const auto &a, const auto &b) {
+			    return a->m_name < b->m_name;
+		    });
+
+		    if (result.size() > limit)
+			    result.resize(limit);
+	    }
+
+	    return result;
+    })
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    std::vector<std::shared_ptr<BaseNode>> BaseNode::getChildrenInRange(std::string_view first, std::string_view last, std::size_t limit),
+    std::vector<std::shared_ptr<const BaseNode>> BaseNode::getChildrenInRange(std::string_view first, std::string_view last, std::size_t limit) const,
+    {
+	    using return_type = decltype(getChildrenInRange(first, last, limit));
+	    return_type result = {};
+
+	    if (!last.empty() && last <= first)
+		    return result;
+
+	    if (m_childIndex) {
+		    const auto end = last.empty() ? m_childIndex->end() : m_childIndex->lower_bound(last);
+
+		    for (auto it = m_childIndex->lower_bound(first); it != end && result.size() < limit; ++it)
+			    result.push_back(it->second);
+	    }
+	    else {
+		    for (const auto &child : m_children)
+			    if (first <= child->m_name && (last.empty() || child->m_name < last))
+				    result.push_back(child);
+
+		    std::sort(result.begin(), result.end(), [](const auto &a, const auto &b) {
+			    return a->m_name < b->m_name;
+		    });
+
+		    if (result.size() > limit)
+			    result.resize(limit);
+	    }
+
+	    return result;
+    })
+
+CPPTREE_IMPL_DEF_FOR_MULTIPLE_SIGNATURES(
+    std::vector<std::shared_ptr<BaseNode>> BaseNode::getNodesByPrefix(std::string_view prefix, unsigned int depth),
+    std::vector<std::shared_ptr<const BaseNode>> BaseNode::getNodesByPrefix(std::string_view prefix, unsigned int depth) const,
+    {
+	    using return_type = decltype(getNodesByPrefix(prefix, depth));
+	    if (depth == 0) {
+		    return {};
+	    }
+	    else {
+		    return_type result = getChildrenByPrefix(prefix);
+
+		    for (const auto &child : m_children) {
+			    auto matchesOfChild = child->getNodesByPrefix(prefix, depth - 1);
+			    result.insert(result.end(), matchesOfChild.begin(), matchesOfChild.end());
+		    }
+
+		    return result;
+	    }
+    })
+
 std::string BaseNode::getPath() const
 {
 	using namespace std::string_literals;
@@ -350,6 +1029,62 @@ std::string BaseNode::getTree(bool includeTypes, unsigned int initialIndent, uns
 	return result;
 }
 
+std::shared_ptr<const NodeSnapshot> BaseNode::snapshot() const
+{
+	// stale nodes are rebuilt children first with an explicit stack, so deep trees can't overflow the stack
+	std::vector<std::pair<const BaseNode *, bool>> pending = {{this, false}};
+
+	while (!pending.empty()) {
+		const auto [node, expanded] = pending.back();
+
+		if (node->m_snapshot) {
+			pending.pop_back();
+			continue;
+		}
+
+		if (!expanded) {
+			pending.back().second = true;
+
+			for (const auto &child : node->m_children)
+				if (!child->m_snapshot)
+					pending.emplace_back(child.get(), false);
+
+			continue;
+		}
+
+		pending.pop_back();
+
+		std::vector<std::shared_ptr<const NodeSnapshot>> children;
+		children.reserve(node->m_children.size());
+
+		for (const auto &child : node->m_children)
+			children.push_back(child->m_snapshot);
+
+		node->m_snapshot = CPPTREE_ALLOCATOR<NodeSnapshot>(node->m_name, node->m_nameHash, node->getType(), node->getTypeHash(),
+		                                                   std::move(children), node->createSnapshotPayload());
+	}
+
+	return m_snapshot;
+}
+
+void BaseNode::releaseSnapshots()
+{
+	// invalidateSnapshot also drops the caches of other parents, which would otherwise keep holding the snapshots
+	std::vector<BaseNode *> pending = {this};
+	std::unordered_set<const BaseNode *> visited = {this};
+
+	while (!pending.empty()) {
+		BaseNode *node = pending.back();
+		pending.pop_back();
+
+		node->invalidateSnapshot();
+
+		for (const auto &child : node->m_children)
+			if (visited.insert(child.get()).second)
+				pending.push_back(child.get());
+	}
+}
+
 /* virtual */ std::string BaseNode::toString() const
 {
 	using namespace std::string_literals;
@@ -361,20 +1096,20 @@ std::string BaseNode::getTree(bool includeTypes, unsigned int initialIndent, uns
 
 #pragma region Node
 
-Node::Node(const std::string &name)
-    : BaseNode(name)
+Node::Node(std::string name)
+    : BaseNode(std::move(name))
 {
 }
 
 bool Node::addLocalNode(std::shared_ptr<BaseNode> node)
 {
-	return addChild(node);
+	return addChild(std::move(node));
 }
 
 bool Node::addNode(const std::string &path, std::shared_ptr<BaseNode> node)
 {
 	if (path == "" || path == std::string()) {
-		return addLocalNode(node);
+		return addLocalNode(std::move(node));
 	}
 	else {
 		auto parent = std::dynamic_pointer_cast<Node>(getNodeByPath(path));
@@ -382,7 +1117,7 @@ bool Node::addNode(const std::string &path, std::shared_ptr<BaseNode> node)
 		if (!parent)
 			return false;
 
-		return parent->addChild(node);
+		return parent->addChild(std::move(node));
 	}
 }
 
@@ -396,13 +1131,52 @@ bool Node::removeLocalNode(const std::shared_ptr<BaseNode> &node)
 	return removeChild(node);
 }
 
+bool Node::moveNode(const std::shared_ptr<BaseNode> &node, const std::shared_ptr<BaseNode> &newParent)
+{
+	return moveBetween(this, node, dynamic_cast<Node *>(newParent.get()));
+}
+
+bool Node::moveNode(const std::string &srcPath, const std::string &dstPath)
+{
+	const auto lastSlash = srcPath.rfind('/');
+	const auto oldParent = (lastSlash == std::string::npos) ? std::shared_ptr<BaseNode>() : getNodeByPath(srcPath.substr(0, lastSlash));
+	const auto newParent = dstPath.empty() ? std::shared_ptr<BaseNode>() : getNodeByPath(dstPath);
+
+	if ((lastSlash != std::string::npos && !oldParent) || (!dstPath.empty() && !newParent))
+		return false;
+
+	Node *const from = oldParent ? dynamic_cast<Node *>(oldParent.get()) : this;
+	Node *const to = newParent ? dynamic_cast<Node *>(newParent.get()) : this;
+
+	if (!from)
+		return false;
+
+	return moveBetween(from, from->getNodeByPath(srcPath.substr(lastSlash + 1)), to);
+}
+
+/* protected virtual */ bool Node::isValidMove(Change, const BaseNode *) const
+{
+	return true;
+}
+
+/* private */ bool Node::moveBetween(Node *from, const std::shared_ptr<BaseNode> &node, Node *to)
+{
+	if (!from || !to || !node)
+		return false;
+
+	if (!from->isValidMove(Change::REMOVE, node.get()) || !to->isValidMove(Change::ADD, node.get()))
+		return false;
+
+	return from->moveChild(node, to);
+}
+
 // Node
 #pragma endregion
 
 #pragma region RestrictiveNode
 
-RestrictiveNode::RestrictiveNode(const std::string &name, std::vector<std::string> addtype, std::vector<std::string> remtype)
-    : Node(name), m_settings{addtype, remtype}
+RestrictiveNode::RestrictiveNode(std::string name, std::vector<std::string> addtype, std::vector<std::string> remtype)
+    : Node(std::move(name)), m_settings{std::move(addtype), std::move(remtype)}
 {
 }
 
@@ -412,7 +1186,7 @@ RestrictiveNode::RestrictiveNode(const std::string &name, std::vector<std::strin
 		return false;
 	return (std::count(m_settings.allow_addtype.begin(), m_settings.allow_addtype.end(), node->getType()) == 0)
 	           ? false
-	           : Node::addLocalNode(node);
+	           : Node::addLocalNode(std::move(node));
 }
 
 /* virtual */ bool RestrictiveNode::removeLocalNode(const std::string &name) /* override */
@@ -427,8 +1201,7 @@ RestrictiveNode::RestrictiveNode(const std::string &name, std::vector<std::strin
 			return false;
 		}
 		else {
-			m_children.erase(childIterator);
-			return true;
+			return Node::removeLocalNode(name);
 		}
 	}
 
@@ -442,6 +1215,12 @@ RestrictiveNode::RestrictiveNode(const std::string &name, std::vector<std::strin
 	           : Node::removeLocalNode(node);
 }
 
+/* protected virtual */ bool RestrictiveNode::isValidMove(Change type, const BaseNode *node) const /* override */
+{
+	const auto &allowed = (type == Change::ADD) ? m_settings.allow_addtype : m_settings.allow_remtype;
+	return std::count(allowed.begin(), allowed.end(), node->getType()) != 0;
+}
+
 // RestrictiveNode
 #pragma endregion
 
@@ -0,0 +1,57 @@
+#include "cppTreeNodeTable.h"
+
+namespace cpptree {
+
+NodeTable::NodeTable()
+    : m_slots(), m_freeSlots(), m_size(0), m_root(nullptr)
+{
+}
+
+/* private */ NodeId NodeTable::insert(BaseNode *node)
+{
+	++m_size;
+
+	if (m_freeSlots.empty()) {
+		m_slots.push_back({node, 1});
+		return {static_cast<std::uint32_t>(m_slots.size() - 1), 1};
+	}
+
+	const auto index = m_freeSlots.back();
+	m_freeSlots.pop_back();
+
+	auto &slot = m_slots[index];
+	slot.node = node;
+
+	return {index, slot.generation};
+}
+
+/* private */ void NodeTable::erase(NodeId id)
+{
+	if (lookup(id) == nullptr)
+		return;
+
+	auto &slot = m_slots[id.index];
+
+	if (slot.node == m_root)
+		m_root = nullptr;
+
+	slot.node = nullptr;
+
+	// generation 0 marks invalid ids, so it is skipped on overflow
+	if (++slot.generation == 0)
+		slot.generation = 1;
+
+	m_freeSlots.push_back(id.index);
+	--m_size;
+}
+
+BaseNode *NodeTable::lookup(NodeId id) const
+{
+	if (id.index >= m_slots.size())
+		return nullptr;
+
+	const auto &slot = m_slots[id.index];
+	return slot.generation == id.generation ? slot.node : nullptr;
+}
+
+} // namespace cpptree
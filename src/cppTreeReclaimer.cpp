@@ -0,0 +1,115 @@
+#include "cppTreeReclaimer.h"
+
+#include <algorithm>
+
+namespace cpptree {
+
+Reclaimer::Reclaimer()
+    : m_pending(), m_mutex(), m_condition(), m_thread(), m_stopping(false)
+{
+}
+
+Reclaimer::~Reclaimer()
+{
+	stop();
+	reclaim();
+}
+
+void Reclaimer::retire(std::shared_ptr<BaseNode> node)
+{
+	if (!node)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending.push_back(std::move(node));
+	}
+
+	m_condition.notify_one();
+}
+
+std::size_t Reclaimer::reclaim(std::size_t maxSteps)
+{
+	std::size_t released = 0;
+	std::size_t steps = 0;
+	std::vector<std::shared_ptr<BaseNode>> orphans;
+
+	while (steps < maxSteps) {
+		std::shared_ptr<BaseNode> node;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending.insert(m_pending.end(), std::make_move_iterator(orphans.begin()), std::make_move_iterator(orphans.end()));
+			orphans.clear();
+
+			if (m_pending.empty())
+				break;
+
+			node = std::move(m_pending.back());
+			m_pending.pop_back();
+		}
+
+		// a node still owned elsewhere is simply let go, its subtree is released with the last owner
+		if (node.use_count() != 1)
+			continue;
+
+		// every detached child is a step, so nodes with many children are released over several batches
+		steps += std::max<std::size_t>(node->releaseChildren(orphans, maxSteps - steps), 1);
+
+		if (node->m_children.empty())
+			++released;
+		else
+			orphans.push_back(std::move(node));
+	}
+
+	if (!orphans.empty()) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_pending.insert(m_pending.end(), std::make_move_iterator(orphans.begin()), std::make_move_iterator(orphans.end()));
+	}
+
+	return released;
+}
+
+void Reclaimer::start(std::size_t batchSize)
+{
+	if (m_thread.joinable())
+		return;
+
+	m_stopping = false;
+	m_thread = std::thread([this, batchSize]() {
+		std::unique_lock<std::mutex> lock(m_mutex);
+
+		while (true) {
+			m_condition.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+
+			if (m_stopping)
+				break;
+
+			lock.unlock();
+			reclaim(batchSize);
+			lock.lock();
+		}
+	});
+}
+
+void Reclaimer::stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+
+	m_condition.notify_one();
+	m_thread.join();
+}
+
+std::size_t Reclaimer::countPending() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_pending.size();
+}
+
+} // namespace cpptree
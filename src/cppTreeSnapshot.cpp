@@ -0,0 +1,87 @@
+#include "cppTreeSnapshot.h"
+
+#include <functional>
+#include <utility>
+
+namespace cpptree {
+
+NodeSnapshot::NodeSnapshot(std::string name, std::size_t nameHash, std::string type, std::size_t typeHash,
+                           std::vector<std::shared_ptr<const NodeSnapshot>> children, std::shared_ptr<const SnapshotPayload> payload)
+    : m_children(std::move(children)), m_name(std::move(name)), m_nameHash(nameHash),
+      m_type(std::move(type)), m_typeHash(typeHash), m_payload(std::move(payload)), m_descendantCount(m_children.size())
+{
+	for (const auto &child : m_children)
+		m_descendantCount += child->m_descendantCount;
+}
+
+NodeSnapshot::~NodeSnapshot()
+{
+	// released iteratively, like cpptree::BaseNode, so deep snapshots can't overflow the stack
+	std::vector<std::shared_ptr<const NodeSnapshot>> orphans;
+	const auto releaseChildren = [&orphans](std::vector<std::shared_ptr<const NodeSnapshot>> &children) {
+		for (auto &child : children)
+			if (child.use_count() == 1)
+				orphans.push_back(std::move(child));
+
+		children.clear();
+	};
+
+	releaseChildren(m_children);
+
+	while (!orphans.empty()) {
+		auto node = std::move(orphans.back());
+		orphans.pop_back();
+
+		// the last owner may modify the snapshot, as it is about to be destroyed
+		releaseChildren(const_cast<NodeSnapshot &>(*node).m_children);
+	}
+}
+
+std::shared_ptr<const NodeSnapshot> NodeSnapshot::getNodeByPath(const std::string &path) const
+{
+	const auto firstSlash = path.find('/');
+
+	if (firstSlash == std::string::npos)
+		return getNodeByNameHash(std::hash<std::string>{}(path));
+
+	const auto containingChild = getNodeByNameHash(std::hash<std::string>{}(path.substr(0, firstSlash)));
+
+	if (!containingChild)
+		return nullptr;
+	else
+		return containingChild->getNodeByPath(path.substr(firstSlash + 1));
+}
+
+std::shared_ptr<const NodeSnapshot> NodeSnapshot::getNodeByNameHash(std::size_t nameHash) const
+{
+	for (const auto &child : m_children)
+		if (child->m_nameHash == nameHash)
+			return child;
+
+	return nullptr;
+}
+
+std::size_t NodeSnapshot::countNodes(unsigned int depth) const
+{
+	if (depth == static_cast<unsigned int>(~0))
+		return m_descendantCount;
+
+	// counted with an explicit stack, so deep snapshots can't overflow the stack
+	std::size_t result = 0;
+	std::vector<std::pair<const NodeSnapshot *, unsigned int>> pending = {{this, depth}};
+
+	while (!pending.empty()) {
+		const auto [node, remaining] = pending.back();
+		pending.pop_back();
+
+		result += node->m_children.size();
+
+		if (remaining > 0)
+			for (const auto &child : node->m_children)
+				pending.emplace_back(child.get(), remaining - 1);
+	}
+
+	return result;
+}
+
+} // namespace cpptree
@@ -1,7 +1,10 @@
 #include "cppTreeNode.h"
+#include "cppTreeReclaimer.h"
 
 #include <catch2/catch_all.hpp>
+#include <chrono>
 #include <cstdint>
+#include <thread>
 
 class TestNode : public cpptree::BaseNode {
 public:
@@ -39,6 +42,91 @@ protected:
 	}
 };
 
+class CountingNode : public cpptree::Node {
+public:
+	int subChildAdds = 0;
+	int subChildRemoves = 0;
+	int parentMoves = 0;
+	std::vector<std::string> *subChildLog = nullptr;
+
+public:
+	CountingNode(const std::string &name)
+	    : Node(name)
+	{
+	}
+
+protected:
+	inline virtual void onParentChange(cpptree::BaseNode::Change type, const cpptree::BaseNode *newParent) final
+	{
+		parentMoves += type == Change::MOVE;
+	}
+
+	inline virtual void onSubChildChange(cpptree::BaseNode::Change type, const std::shared_ptr<cpptree::BaseNode> &child) final
+	{
+		subChildAdds += type == Change::ADD;
+		subChildRemoves += type == Change::REMOVE;
+
+		if (subChildLog)
+			subChildLog->push_back(getName());
+	}
+};
+
+class ValuePayload : public cpptree::SnapshotPayload {
+public:
+	const int value;
+
+public:
+	ValuePayload(int i_value)
+	    : value(i_value)
+	{
+	}
+};
+
+class ValueNode : public cpptree::Node {
+private:
+	int m_value;
+
+public:
+	ValueNode(const std::string &name, int value)
+	    : Node(name), m_value(value)
+	{
+	}
+
+	void setValue(int value)
+	{
+		m_value = value;
+		invalidateSnapshot();
+	}
+
+protected:
+	inline virtual std::shared_ptr<const cpptree::SnapshotPayload> createSnapshotPayload() const final
+	{
+		return std::make_shared<const ValuePayload>(m_value);
+	}
+};
+
+class WeightNode : public cpptree::Node {
+public:
+	int weight;
+	int totalWeight;
+
+public:
+	WeightNode(const std::string &name, int i_weight)
+	    : Node(name), weight(i_weight), totalWeight(i_weight)
+	{
+	}
+
+protected:
+	inline virtual void onAggregateUpdate(const cpptree::BaseNode *child) final
+	{
+		totalWeight = weight;
+
+		for (const auto &node : getChildren_c())
+			if (const auto weighted = node->as<WeightNode>())
+				totalWeight += weighted->totalWeight;
+	}
+};
+
 TEST_CASE("cpptree", "[cpptree]")
 {
 	cpptree::NodePtr ptr;
@@ -79,6 +167,366 @@ TEST_CASE("cpptree", "[cpptree]")
 				REQUIRE(ptr->getNodeByPath(std::string(childName) + "/test5") != nullptr);
 			}
 		}
+
+		SECTION("emplacing children")
+		{
+			auto childPtr = ptr->emplaceLocalNode<cpptree::Node>(std::string(childName));
+
+			REQUIRE(childPtr != nullptr);
+			REQUIRE(childPtr->getName() == childName);
+			REQUIRE(ptr->getNodeByPath(childName) == childPtr);
+			REQUIRE(ptr->emplaceLocalNode<cpptree::Node>(childName) == nullptr);
+
+			auto grandChildPtr = ptr->emplaceNode<cpptree::BaseNode>(childName, "test5/test6");
+
+			REQUIRE(grandChildPtr != nullptr);
+			REQUIRE(grandChildPtr->getName() == "test5_test6");
+			REQUIRE(ptr->getNodeByPath(std::string(childName) + "/test5_test6") == grandChildPtr);
+			REQUIRE(ptr->emplaceNode<cpptree::Node>("nonexistent", "test7") == nullptr);
+		}
+
+		SECTION("snapshots")
+		{
+			auto childPtr = ptr->emplaceLocalNode<cpptree::Node>(childName);
+			ptr->emplaceLocalNode<cpptree::Node>("test5")->emplaceLocalNode<cpptree::BaseNode>("test6");
+
+			auto first = ptr->snapshot();
+			REQUIRE(ptr->snapshot() == first);
+			REQUIRE(first->getName() == parentName);
+			REQUIRE(first->getType() == cpptree::Node::nodeTypeName);
+			REQUIRE(first->countNodes() == 3);
+
+			childPtr->emplaceLocalNode<cpptree::BaseNode>("test7");
+			auto second = ptr->snapshot();
+
+			REQUIRE(second != first);
+			REQUIRE(first->countNodes() == 3);
+			REQUIRE(first->getNodeByPath(childName + "/test7") == nullptr);
+			REQUIRE(second->getNodeByPath(childName + "/test7") != nullptr);
+			REQUIRE(second->getNodeByPath("test5") == first->getNodeByPath("test5"));
+
+			ptr->removeLocalNode("test5");
+			REQUIRE(ptr->snapshot()->getNodeByPath("test5") == nullptr);
+			REQUIRE(second->getNodeByPath("test5/test6") != nullptr);
+
+			const auto third = ptr->snapshot();
+			childPtr->releaseSnapshots();
+			REQUIRE(ptr->snapshot() != third);
+			REQUIRE(ptr->snapshot()->getNodeByPath(childName) != third->getNodeByPath(childName));
+			REQUIRE(ptr->snapshot()->countNodes() == third->countNodes());
+
+			SECTION("payloads")
+			{
+				auto valuePtr = childPtr->emplaceLocalNode<ValueNode>("value", 1);
+				const auto before = ptr->snapshot();
+
+				valuePtr->setValue(2);
+				const auto after = ptr->snapshot();
+
+				REQUIRE(before->getNodeByPath(childName + "/value")->getPayload<ValuePayload>()->value == 1);
+				REQUIRE(after->getNodeByPath(childName + "/value")->getPayload<ValuePayload>()->value == 2);
+				REQUIRE(after->getPayload<ValuePayload>() == nullptr);
+			}
+		}
+
+		SECTION("ordered child index")
+		{
+			for (const auto name : {"shard-2", "other", "shard-1", "shard-3", "zz"})
+				ptr->emplaceLocalNode<cpptree::Node>(name);
+
+			const auto checkQueries = [&ptr]() {
+				const auto prefixed = ptr->getChildrenByPrefix("shard-");
+				REQUIRE(prefixed.size() == 3);
+				REQUIRE(prefixed[0]->getName() == "shard-1");
+				REQUIRE(prefixed[2]->getName() == "shard-3");
+				REQUIRE(ptr->getChildrenByPrefix("shard-", 2).size() == 2);
+
+				const auto ranged = ptr->getChildrenInRange("shard-2", "zz");
+				REQUIRE(ranged.size() == 2);
+				REQUIRE(ranged[0]->getName() == "shard-2");
+				REQUIRE(ranged[1]->getName() == "shard-3");
+				REQUIRE(ptr->getChildrenInRange("shard-3", "").size() == 2);
+				REQUIRE(ptr->getChildrenInRange("zz", "shard-2").empty());
+				REQUIRE(ptr->getChildrenInRange("shard-2", "shard-2").empty());
+
+				REQUIRE(ptr->getChildrenOrdered().front()->getName() == "other");
+				REQUIRE(ptr->getChildrenOrdered().back()->getName() == "zz");
+			};
+
+			checkQueries();
+
+			ptr->setChildIndex(true);
+			REQUIRE(ptr->hasChildIndex());
+			checkQueries();
+
+			ptr->emplaceNode<cpptree::Node>("shard-1", "shard-4");
+			ptr->removeLocalNode("shard-2");
+			REQUIRE(ptr->getChildrenByPrefix("shard-").size() == 2);
+			REQUIRE(ptr->getNodesByPrefix("shard-").size() == 3);
+		}
+
+		SECTION("ancestor queries and cycles")
+		{
+			auto a = ptr->emplaceLocalNode<cpptree::Node>("a");
+			auto b = a->emplaceLocalNode<cpptree::Node>("b");
+			auto c = b->emplaceLocalNode<cpptree::Node>("c");
+			auto d = a->emplaceLocalNode<cpptree::Node>("d");
+
+			REQUIRE(ptr->isAncestorOf(c.get()));
+			REQUIRE(a->isAncestorOf(c.get()));
+			REQUIRE(c->isDescendantOf(ptr.get()));
+			REQUIRE_FALSE(c->isAncestorOf(a.get()));
+			REQUIRE_FALSE(d->isAncestorOf(c.get()));
+			REQUIRE_FALSE(c->isAncestorOf(c.get()));
+
+			REQUIRE(c->lowestCommonAncestor(d.get()) == a.get());
+			REQUIRE(c->lowestCommonAncestor(b.get()) == b.get());
+			REQUIRE(b->lowestCommonAncestor(ptr.get()) == ptr.get());
+
+			REQUIRE_FALSE(c->addLocalNode(a));
+			REQUIRE_FALSE(b->addLocalNode(b));
+			REQUIRE(ptr->countNodes() == 4);
+
+			// a second parent below the node's old position is fine, and keeps the ancestry up to date
+			REQUIRE(d->addLocalNode(c));
+			REQUIRE(d->isAncestorOf(c.get()));
+			REQUIRE_FALSE(c->addLocalNode(d));
+
+			// trees built bottom-up keep working as well
+			auto root = cpptree::Node::create("root");
+			root->addLocalNode(ptr);
+			REQUIRE(root->isAncestorOf(c.get()));
+			REQUIRE_FALSE(c->addLocalNode(root));
+		}
+
+		SECTION("node ids")
+		{
+			auto a = ptr->emplaceLocalNode<cpptree::Node>("a");
+			auto b = a->emplaceLocalNode<cpptree::Node>("b");
+
+			REQUIRE_FALSE(a->getId().isValid());
+
+			const auto table = ptr->enableNodeIds();
+			REQUIRE(table->size() == 3);
+			REQUIRE(ptr->enableNodeIds() == table);
+
+			const auto c = a->emplaceLocalNode<cpptree::Node>("c");
+			const auto cId = c->getId();
+			REQUIRE(cId.isValid());
+			REQUIRE(ptr->getNodeById(cId) == c.get());
+			REQUIRE(ptr->getNodeIdByPath("a/c") == cId);
+			REQUIRE(ptr->getNodeIdsByName("b") == std::vector<cpptree::NodeId>{ptr->getNodeIdByPath("a/b")});
+			REQUIRE(ptr->getNodeIdsByTypeHash(cpptree::Node::nodeType).size() == 3);
+
+			// a node with another parent in the tree keeps its id
+			auto d = ptr->emplaceLocalNode<cpptree::Node>("d");
+			REQUIRE(d->addLocalNode(b));
+			const auto bId = ptr->getNodeIdByPath("d/b");
+
+			a->removeLocalNode("c");
+			ptr->removeLocalNode("a");
+			REQUIRE(table->lookup(cId) == nullptr);
+			REQUIRE(table->lookup(bId) != nullptr);
+			REQUIRE(table->size() == 3);
+
+			// reused slots never resolve stale ids
+			ptr->emplaceLocalNode<cpptree::Node>("e");
+			REQUIRE(table->lookup(cId) == nullptr);
+
+			// the node which created the table keeps it when it is attached elsewhere and detached again
+			auto holder = cpptree::Node::create("holder");
+			REQUIRE(holder->addLocalNode(ptr));
+			REQUIRE(holder->removeLocalNode(ptr));
+			REQUIRE(table->size() == 4);
+			REQUIRE(table->lookup(bId) != nullptr);
+			REQUIRE(table->getRoot() == ptr.get());
+			REQUIRE(ptr->emplaceLocalNode<cpptree::Node>("f")->getId().isValid());
+
+			// nodes shared with a tree with its own table keep their first table while they can reach it
+			auto other = cpptree::Node::create("other");
+			const auto otherTable = other->enableNodeIds();
+			auto shared = ptr->emplaceLocalNode<cpptree::Node>("shared");
+			shared->emplaceLocalNode<cpptree::Node>("g");
+			const auto sharedId = shared->getId();
+
+			REQUIRE(other->addLocalNode(shared));
+			REQUIRE(table->lookup(sharedId) == shared.get());
+			REQUIRE(otherTable->size() == 1);
+
+			REQUIRE(other->removeLocalNode(shared));
+			REQUIRE(table->lookup(sharedId) == shared.get());
+
+			REQUIRE(other->addLocalNode(shared));
+			REQUIRE(ptr->removeLocalNode(shared));
+			REQUIRE(table->lookup(sharedId) == nullptr);
+			REQUIRE(shared->getNodeTable() == otherTable);
+			REQUIRE(otherTable->size() == 3);
+			REQUIRE(other->getNodeById(shared->emplaceLocalNode<cpptree::Node>("h")->getId()) != nullptr);
+		}
+
+		SECTION("moving nodes")
+		{
+			auto a = ptr->emplaceLocalNode<CountingNode>("a");
+			auto b = a->emplaceLocalNode<CountingNode>("b");
+			auto c = a->emplaceLocalNode<CountingNode>("c");
+			auto d = b->emplaceLocalNode<CountingNode>("d");
+			d->emplaceLocalNode<cpptree::Node>("e");
+
+			a->subChildAdds = 0;
+			ptr->setChildIndex(true);
+			const auto table = ptr->enableNodeIds();
+			const auto dId = d->getId();
+
+			REQUIRE_FALSE(ptr->moveNode(d, c));
+			REQUIRE(b->moveNode(d, c));
+			REQUIRE(ptr->getNodeByPath("a/b/d") == nullptr);
+			REQUIRE(ptr->getNodeByPath("a/c/d/e") != nullptr);
+			REQUIRE(d->parentMoves == 1);
+			REQUIRE(a->subChildAdds == 0);
+			REQUIRE(a->subChildRemoves == 0);
+			REQUIRE(d->getPath() == parentName + "/a/c/d");
+			REQUIRE(table->lookup(dId) == d.get());
+
+			REQUIRE(ptr->moveNode("a/c/d", ""));
+			REQUIRE(a->subChildRemoves == 1);
+			REQUIRE(ptr->getChildrenByPrefix("d").size() == 1);
+			REQUIRE(ptr->countNodes() == 5);
+
+			REQUIRE_FALSE(ptr->moveNode("d", "d/e"));
+			REQUIRE_FALSE(ptr->moveNode("a", "a/b"));
+			REQUIRE_FALSE(ptr->moveNode("d", "a/c/nonexistent"));
+			REQUIRE_FALSE(ptr->moveNode("a/b", "a"));
+
+			// ancestors are notified bottom-up, like for adding and removing nodes
+			std::vector<std::string> subChildLog;
+			auto q = ptr->emplaceLocalNode<CountingNode>("q");
+			auto r = q->emplaceLocalNode<CountingNode>("r");
+			auto s = r->emplaceLocalNode<CountingNode>("s");
+			auto m = s->emplaceLocalNode<cpptree::Node>("m");
+			q->subChildLog = r->subChildLog = s->subChildLog = &subChildLog;
+
+			const std::vector<std::string> expectedLog = {"r", "q"};
+			REQUIRE(s->moveNode(m, ptr));
+			REQUIRE(subChildLog == expectedLog);
+
+			SECTION("move policies")
+			{
+				auto closed = cpptree::RestrictiveNode::create("closed");
+				auto open = cpptree::RestrictiveNode::create("open", {"Node"}, {});
+				auto plain = cpptree::BaseNode::create("plain");
+				auto x = ptr->emplaceLocalNode<cpptree::Node>("x");
+				REQUIRE(ptr->addLocalNode(closed));
+				REQUIRE(ptr->addLocalNode(open));
+				REQUIRE(ptr->addLocalNode(plain));
+
+				REQUIRE_FALSE(closed->addLocalNode(x));
+				REQUIRE_FALSE(ptr->moveNode(x, closed));
+				REQUIRE_FALSE(ptr->moveNode("x", "closed"));
+				REQUIRE(x->getPath() == parentName + "/x");
+
+				REQUIRE_FALSE(ptr->moveNode(x, plain));
+				REQUIRE_FALSE(ptr->moveNode("x", "plain"));
+				REQUIRE(plain->getChildren().empty());
+
+				REQUIRE(ptr->moveNode(x, open));
+				REQUIRE_FALSE(open->removeLocalNode(x));
+				REQUIRE_FALSE(open->moveNode(x, ptr));
+				REQUIRE_FALSE(ptr->moveNode("open/x", ""));
+				REQUIRE(x->getPath() == parentName + "/open/x");
+			}
+		}
+
+		SECTION("subtree aggregates")
+		{
+			auto a = ptr->emplaceLocalNode<WeightNode>("a", 1);
+			auto b = a->emplaceLocalNode<WeightNode>("b", 2);
+			b->emplaceLocalNode<WeightNode>("c", 4);
+			auto d = ptr->emplaceLocalNode<WeightNode>("d", 8);
+
+			REQUIRE(ptr->countNodes() == 4);
+			REQUIRE(ptr->countNodes(1) == 3);
+			REQUIRE(ptr->getMaxDepth() == 3);
+			REQUIRE(a->totalWeight == 7);
+
+			REQUIRE(ptr->moveNode("a/b", "d"));
+			REQUIRE(ptr->countNodes() == 4);
+			REQUIRE(a->countNodes() == 0);
+			REQUIRE(ptr->getMaxDepth() == 3);
+			REQUIRE(a->totalWeight == 1);
+			REQUIRE(d->totalWeight == 14);
+
+			d->removeLocalNode("b");
+			REQUIRE(ptr->countNodes() == 2);
+			REQUIRE(ptr->getMaxDepth() == 1);
+			REQUIRE(d->totalWeight == 8);
+		}
+
+		SECTION("teardown")
+		{
+			const auto makeChain = [](std::size_t length) {
+				auto chain = cpptree::Node::create("link");
+
+				for (std::size_t i = 1; i < length; ++i) {
+					auto link = cpptree::Node::create("link");
+					link->addLocalNode(chain);
+					chain = link;
+				}
+
+				return chain;
+			};
+
+			SECTION("deep trees are destroyed without recursion")
+			{
+				auto chain = makeChain(200000);
+				REQUIRE(chain->countParents() == 0);
+				REQUIRE(chain->snapshot()->countNodes(0) == 1);
+				REQUIRE(chain->snapshot()->countNodes() == 199999);
+				REQUIRE(chain->snapshot()->countNodes(199999) == 199999);
+				chain.reset();
+			}
+
+			SECTION("deferred reclamation")
+			{
+				cpptree::Reclaimer reclaimer;
+				reclaimer.retire(makeChain(10));
+
+				REQUIRE(reclaimer.reclaim(4) == 4);
+				REQUIRE(reclaimer.countPending() == 1);
+				REQUIRE(reclaimer.reclaim() == 6);
+				REQUIRE(reclaimer.countPending() == 0);
+
+				auto shared = makeChain(2);
+				reclaimer.retire(shared);
+				REQUIRE(reclaimer.reclaim() == 0);
+				REQUIRE(shared->countNodes() == 1);
+
+				// detaching children is bounded too, a wide node is released over several calls
+				auto wide = cpptree::Node::create("wide");
+				for (int i = 0; i < 100; ++i)
+					wide->emplaceLocalNode<cpptree::BaseNode>(std::to_string(i));
+
+				reclaimer.retire(std::move(wide));
+				REQUIRE(reclaimer.reclaim(10) == 0);
+				REQUIRE(reclaimer.countPending() == 11);
+				REQUIRE(reclaimer.reclaim() == 101);
+
+				auto chain = makeChain(1000);
+				std::weak_ptr<cpptree::BaseNode> last = chain;
+				while (!last.lock()->getChildren().empty())
+					last = last.lock()->getChildren().front();
+
+				reclaimer.start(16);
+				reclaimer.retire(std::move(chain));
+
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+				while (!last.expired() && std::chrono::steady_clock::now() < deadline)
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+				reclaimer.stop();
+				REQUIRE(last.expired());
+				REQUIRE(reclaimer.countPending() == 0);
+			}
+		}
 	}
 
 	//! @todo